@@ -10,6 +10,21 @@ set -o pipefail
 
 # Default Values
 hidebanner=0
+loops=0
+profiling=0
+dead_code_report=0
+mcdc=0
+coverage_flags=(--coverage)
+diff_range=""
+snapshot_interval=""
+snapshots_ingested=0
+coverage_info="main_coverage.info"
+ir_version=5
+report_version=1
+ir_file=""
+record_history=0
+history_query=""
+stage_times=()
 version=0.1
 file_name=""
 file_path=""
@@ -103,24 +118,751 @@ installation() {
         print_color "gdb is not installed. Please install gdb before running this script." red
         exit 1
     fi
+
+    if [ $mcdc == 1 ]; then
+        if echo "" | gcc -fcondition-coverage -x c -E - &> /dev/null; then
+            print_color "GCC supports condition coverage!"
+        else
+            print_color "MC/DC mode requires GCC 14 or newer (-fcondition-coverage)." red
+            exit 1
+        fi
+    fi
+
+    if [ -n "$snapshot_interval" ]; then
+        if command -v gcov-tool &> /dev/null; then
+            print_color "gcov-tool is installed!"
+        else
+            print_color "gcov-tool is not installed. It is required to merge live coverage snapshots." red
+            exit 1
+        fi
+    fi
+}
+
+# Instrumented object cache
+# Keeps the coverage object of compile() together with its .gcno notes, call graph and diagnostics,
+# keyed on the preprocessed source, the compiler identity, the flags and the object path (gcov data paths are absolute)
+# Entries are published with an atomic directory rename, so parallel jobs never see a partial entry,
+# and the least recently used entries are evicted once the cache exceeds $AG_CACHE_SIZE megabytes (default 512)
+
+object_cache_dir="${XDG_CACHE_HOME:-$HOME/.cache}/astroguard/objects"
+object_cache_key=""
+object_cache_files=(o gcno ci diag)
+
+object_cache_fetch() {
+    object_cache_key=$( {
+        realpath -- "${file_path_no_ext}.o"
+        printf '%s\n' "$@"
+        gcc --version | head -1
+        gcc -dumpmachine
+        gcc "$@" -E "${file_path}" 2> /dev/null
+    } | sha256sum | cut -c 1-40)
+
+    local entry="${object_cache_dir}/${object_cache_key}"
+    if [ ! -d "${entry}" ]; then
+        return 1
+    fi
+
+    # An entry evicted while it is being copied is treated as a miss
+    for ext in "${object_cache_files[@]}"; do
+        if ! cp "${entry}/object.${ext}" "${file_path_no_ext}.${ext}" 2> /dev/null; then
+            return 1
+        fi
+    done
+    touch "${entry}"
+    print_color "Object cache hit (${object_cache_key})"
+}
+
+object_cache_store() {
+    local entry="${object_cache_dir}/${object_cache_key}"
+    mkdir -p "${object_cache_dir}"
+
+    local staging
+    staging=$(mktemp -d "${object_cache_dir}/.staging.XXXXXX")
+    for ext in "${object_cache_files[@]}"; do
+        if [ ! -f "${file_path_no_ext}.${ext}" ]; then
+            rm -rf "${staging}"
+            return
+        fi
+        cp "${file_path_no_ext}.${ext}" "${staging}/object.${ext}"
+    done
+
+    # Another job may have published the same entry first, then its copy is kept
+    if [ -d "${entry}" ]; then
+        rm -rf "${staging}"
+    else
+        mv "${staging}" "${entry}"
+        # Losing a race after the check moves the staging directory into the winner's entry
+        rm -rf "${entry:?}/$(basename -- "${staging}")"
+    fi
+
+    cache_evict "${object_cache_dir}"
+}
+
+# Locks are directories, which mkdir creates atomically
+# A lock left behind by a killed job is broken after ten minutes
+break_stale_lock() {
+    if [ -n "$(find "$1" -maxdepth 0 -mmin +10 2> /dev/null)" ]; then
+        rmdir "$1" 2> /dev/null || true
+    fi
+}
+
+# Evicts the least recently used entries of a cache directory (the object cache or the IR cache) past $AG_CACHE_SIZE megabytes
+cache_evict() {
+    local cache_dir="$1"
+    local budget=$(( ${AG_CACHE_SIZE:-512} * 1024 ))
+    local lock="${cache_dir}/.lock"
+
+    # One job evicts at a time, the others leave it to the lock holder
+    break_stale_lock "${lock}"
+    if ! mkdir "${lock}" 2> /dev/null; then
+        return
+    fi
+    trap 'rmdir "${lock}"' EXIT
+
+    # Entries renamed or evicted by other jobs during the walk make du complain, its total is still usable
+    local used
+    used=$(du -sk "${cache_dir}" 2> /dev/null | cut -f 1 || true)
+
+    # Oldest access first
+    local keys=()
+    mapfile -t keys < <(ls -1tr "${cache_dir}")
+    for key in "${keys[@]}"; do
+        if [ "${used:-0}" -le "${budget}" ]; then
+            break
+        fi
+        local size
+        size=$(du -sk "${cache_dir}/${key}" 2> /dev/null | cut -f 1 || true)
+        rm -rf "${cache_dir:?}/${key}"
+        used=$((used - ${size:-0}))
+    done
+
+    rmdir "${lock}"
+    trap - EXIT
 }
 
 # Step #2
 # Compiles the C program
 # Compilations settings set to the most pedantic level
+# The call graph with per-function stack usage is written next to the binary (file.ci)
 
 compile() {
     print_color "Step 2 > Compiling Input File" cyan
-    # Compile the C file
-    gcc -Wall -pedantic -Wtraditional -Wshadow -Wpointer-arith -Wcast-qual -Wcast-align -Wstrict-prototypes -Wmissing-prototypes -Wconversion -std=iso9899:1999 --coverage "${file_path}" -o "${file_path_no_ext}"
+    local link_objects=()
+    local cflags=(-Wall -pedantic -Wtraditional -Wshadow -Wpointer-arith -Wcast-qual -Wcast-align -Wstrict-prototypes -Wmissing-prototypes -Wconversion -std=iso9899:1999 "${coverage_flags[@]}" -fcallgraph-info=su)
 
-    # Check if compilation was successful
-    if [ $? -eq 0 ]; then
-        # Execute the compiled program
-        "${file_path_no_ext}"
-    else
+    # Compile the C file, keeping a copy of the diagnostics for the findings report
+    if ! object_cache_fetch "${cflags[@]}"; then
+        if ! gcc "${cflags[@]}" -c "${file_path}" -o "${file_path_no_ext}.o" 2> "${file_path_no_ext}.diag"; then
+            cat "${file_path_no_ext}.diag" >&2
+            print_color "Compilation failed." red
+            exit 1
+        fi
+        object_cache_store
+    fi
+    cat "${file_path_no_ext}.diag" >&2
+
+    # The snapshot runtime is linked in without coverage so it does not show up in the reports
+    if [ -n "${snapshot_interval}" ]; then
+        gcc -std=iso9899:1999 -pthread -c "./runtime/gcov_snapshot.c" -o "${file_path_no_ext}_snapshot.o"
+        link_objects+=("${file_path_no_ext}_snapshot.o" -pthread)
+    fi
+
+    # Check if linking was successful
+    if ! gcc "${coverage_flags[@]}" "${file_path_no_ext}.o" "${link_objects[@]}" -o "${file_path_no_ext}"; then
         print_color "Compilation failed." red
+        exit 1
+    fi
+
+    # Execute the compiled program
+    if [ -n "${snapshot_interval}" ]; then
+        live_run
+    else
+        "${file_path_no_ext}"
+    fi
+}
+
+# Optional Step (-s)
+# Live coverage snapshots from long-running processes
+# The program runs in the background and is sent SIGUSR1 every interval, see runtime/gcov_snapshot.c
+# Every snapshot is a delta (counters are reset after each dump) written to a timestamped directory of this run
+# Only the new delta is ingested per snapshot, and the deltas are merged back into file.gcda once the program ends
+# Ctrl-C takes a last snapshot and stops the program
+
+live_run() {
+    local object_dir
+    local run_dir
+    local pid
+    local stop=0
+    object_dir=$(realpath -- "$(dirname -- "${file_path}")")
+    run_dir="${object_dir}/${file_name_no_ext}.snapshots/$(date +%Y%m%d-%H%M%S)-$$"
+    mkdir -p "${run_dir}"
+    : > "${run_dir}/index"
+    : > "${run_dir}/covered"
+    : > "${run_dir}/timeline"
+    snapshots_ingested=0
+    rm -f "${file_path_no_ext}.gcda"
+
+    # Strip the whole object directory so every snapshot directory holds a flat file.gcda
+    AG_SNAPSHOT_DIR="${run_dir}" AG_SNAPSHOT_STRIP=$(echo "${object_dir}" | awk -F '/' '{ print NF - 1 }') "${file_path_no_ext}" &
+    pid=$!
+    trap 'stop=1' INT
+    print_color "Taking coverage snapshots of ${file_name_no_ext} (pid ${pid}) every ${snapshot_interval}s into ${run_dir}"
+
+    while kill -0 "${pid}" 2> /dev/null; do
+        sleep "${snapshot_interval}" || true
+        kill -USR1 "${pid}" 2> /dev/null || break
+        if [ $stop == 1 ]; then
+            # Give the helper thread a moment to finish the last dump
+            sleep 1
+            kill -TERM "${pid}" 2> /dev/null || true
+            break
+        fi
+        ingest_snapshots "${run_dir}"
+    done
+    trap - INT
+    wait "${pid}" || [ $stop == 1 ]
+
+    ingest_snapshots "${run_dir}"
+    merge_snapshots "${run_dir}"
+}
+
+ingest_snapshots() {
+    local run_dir="$1"
+    local total
+    total=$(wc -l < "${run_dir}/index")
+    if [ "${total}" -le "${snapshots_ingested}" ]; then
+        return
     fi
+
+    sed -n "$((snapshots_ingested + 1)),${total}p" "${run_dir}/index" | while read -r dir; do
+        ln -sf "$(realpath -- "${file_path_no_ext}.gcno")" "${dir}/${file_name_no_ext}.gcno"
+        gcov -t -o "${dir}" "${file_path}" 2> /dev/null | awk -v covered="${run_dir}/covered" -v timeline="${run_dir}/timeline" -v snapshot="$(basename -- "${dir}")" -v now="$(date +%s)" '
+            BEGIN { while ((getline line < covered) > 0) { seen[line] = 1; hits++ } }
+            /^ *([0-9]+\*?|#####|=====):  *[0-9]+:/ {
+                split($0, f, ":")
+                count = f[1]; line_no = f[2] + 0
+                gsub(/[ *]/, "", count)
+                lines++
+                if (count ~ /^[0-9]+$/ && count + 0 > 0 && !(line_no in seen)) {
+                    seen[line_no] = 1
+                    print line_no >> covered
+                    hits++; new++
+                }
+            }
+            END {
+                printf "%s %s %d %d %d\n", snapshot, now, hits, lines, new >> timeline
+                printf "Snapshot %s: %d of %d lines covered (%.1f%%), +%d new\n", snapshot, hits, lines, (lines > 0 ? 100 * hits / lines : 0), new
+            }
+        ' | while read -r result; do
+            print_color "${result}" green
+        done
+    done
+
+    snapshots_ingested=${total}
+}
+
+merge_snapshots() {
+    local run_dir="$1"
+    local merged="${run_dir}/merged"
+
+    while read -r dir; do
+        if [ ! -f "${dir}/${file_name_no_ext}.gcda" ]; then
+            continue
+        fi
+        if [ ! -d "${merged}" ]; then
+            mkdir -p "${merged}"
+            cp "${dir}/${file_name_no_ext}.gcda" "${merged}/"
+        else
+            gcov-tool merge "${merged}" "${dir}" -o "${merged}.tmp" > /dev/null
+            rm -rf "${merged}"
+            mv "${merged}.tmp" "${merged}"
+        fi
+    done < "${run_dir}/index"
+
+    # The merged counts of the whole run feed the regular coverage steps
+    if [ -f "${merged}/${file_name_no_ext}.gcda" ]; then
+        cp "${merged}/${file_name_no_ext}.gcda" "${file_path_no_ext}.gcda"
+    fi
+}
+
+# Step #2.0
+# Shared IR of the input file used by every rule check
+# One flat, pointer-free record per function (F), loop (L) and call edge (C), built once per distinct source
+# The IR is content addressed (source, call graph, compiler and flags) under ~/.cache/astroguard/ir, so later runs
+# and every check read the same file instead of scanning the source again
+# The IR cache shares the $AG_CACHE_SIZE budget and least recently used eviction of the object cache
+
+ir_load() {
+    local ir_dir="${XDG_CACHE_HOME:-$HOME/.cache}/astroguard/ir"
+    local key
+    # The call graph is part of the key since headers change the calls and frame sizes it reports
+    key=$( { echo "astroguard-ir ${ir_version} ${coverage_flags[*]}"; gcc --version | head -1; cat "${file_path}"; cat "${file_path_no_ext}.ci" 2> /dev/null || true; } | sha256sum | cut -c 1-32)
+    local cached="${ir_dir}/${key}.ir"
+
+    # Checks read a copy next to the input, so an eviction during the run cannot take it away
+    ir_file="${file_path_no_ext}.ir"
+    if cp "${cached}" "${ir_file}" 2> /dev/null; then
+        print_color "IR cache hit (${key})"
+        touch "${cached}"
+        return
+    fi
+
+    mkdir -p "${ir_dir}"
+    local ir_tmp
+    ir_tmp=$(mktemp "${ir_dir}/.${key}.XXXXXX")
+
+    # F name start end stack_bytes recursive depth_bytes / L slot line function bound brace end / C caller callee line
+    # The depth of a function is its worst-case stack depth through the call graph, -1 when recursion makes it unbounded
+    # Every for, while and do loop gets a slot: L slot line function bound brace end enter_col open_line open_col close_col
+    # The brace of a loop body is 0 on the loop line, 1 on a later line and 2 when the loop cannot be instrumented (no braced body)
+    # Columns locate the loop keyword, the brace opening its body and the brace (or the ; of a do-while) closing it
+    awk -v graph="${file_path_no_ext}.ci" -v key="${key}" -v version="${ir_version}" '
+        function bound_of(code, raw, prev,    b) {
+            if (match(raw, /@bound[ \t]+[0-9]+/) || match(prev, /@bound[ \t]+[0-9]+/)) {
+                b = substr(raw, RSTART, RLENGTH)
+                if (b !~ /@bound/) { b = substr(prev, RSTART, RLENGTH) }
+                sub(/@bound[ \t]+/, "", b)
+                return b
+            }
+            if (match(code, /^[ \t]*for[ \t]*\(.*;.*<=[ \t]*[0-9]+[ \t]*;/)) {
+                b = substr(code, RSTART, RLENGTH); sub(/.*<=[ \t]*/, "", b); sub(/[ \t]*;$/, "", b)
+                return b + 1
+            }
+            if (match(code, /^[ \t]*for[ \t]*\(.*;.*<[ \t]*[0-9]+[ \t]*;/)) {
+                b = substr(code, RSTART, RLENGTH); sub(/.*<[ \t]*/, "", b); sub(/[ \t]*;$/, "", b)
+                return b
+            }
+            return "-"
+        }
+        # Blanks comments (also across lines) and the contents of string and character literals
+        # Columns of the remaining code are those of the raw line, a line comment is cut off
+        function strip(text,    out, c, i) {
+            out = ""
+            for (i = 1; i <= length(text); i++) {
+                c = substr(text, i, 1)
+                if (in_comment) {
+                    if (c == "*" && substr(text, i + 1, 1) == "/") { in_comment = 0; i++; out = out " " }
+                    out = out " "
+                    continue
+                }
+                if (quote != "") {
+                    if (c == "\\") { i++; out = out " " } else if (c == quote) { quote = ""; out = out c; continue }
+                    out = out " "
+                    continue
+                }
+                if (c == "/" && substr(text, i + 1, 1) == "*") { in_comment = 1; i++; out = out "  "; continue }
+                if (c == "/" && substr(text, i + 1, 1) == "/") { break }
+                if (c == "\"" || c == "\047") { quote = c }
+                out = out c
+            }
+            quote = ""
+            return out
+        }
+        # Follows the loops of a stripped line through their header, body and (for do) the trailing while (...);
+        function scan_loops(code,    i, c, d, k, word) {
+            d = depth
+            for (i = 1; i <= length(code); i++) {
+                c = substr(code, i, 1)
+                if (c == " " || c == "\t") { continue }
+                word = ""
+                if (c ~ /[A-Za-z_]/ && (i == 1 || substr(code, i - 1, 1) !~ /[A-Za-z0-9_]/)) {
+                    match(substr(code, i), /^[A-Za-z_][A-Za-z0-9_]*/)
+                    word = substr(code, i, RLENGTH)
+                }
+                # The body of a do loop is followed by its while (...);
+                if (do_tail != "") {
+                    k = do_tail; do_tail = ""
+                    if (word == "while") { header_k = k; header_tail = 1; header_parens = 0; i += 4; continue }
+                    loop_brace[k] = 2
+                }
+                if (header_k != "") {
+                    if (c == "(") { header_parens++ }
+                    else if (c == ")" && --header_parens == 0) {
+                        if (header_tail) { semi_k = header_k } else { body_k = header_k }
+                        header_k = ""
+                    }
+                    continue
+                }
+                if (semi_k != "") {
+                    k = semi_k; semi_k = ""
+                    if (c == ";") { loop_end[k] = NR; close_col[k] = i; continue }
+                    loop_brace[k] = 2
+                }
+                if (body_k != "") {
+                    k = body_k; body_k = ""
+                    if (c == "{") {
+                        loop_brace[k] = NR == loop_line[k] ? 0 : 1
+                        open_line[k] = NR; open_col[k] = i
+                        loop_stack[++open_loops] = k; loop_depth[open_loops] = d
+                    } else if (loop_kind[k] == "do") {
+                        do_statement = k
+                    }
+                }
+                if (word == "while" && do_statement != "") {
+                    header_k = do_statement; do_statement = ""; header_tail = 1; header_parens = 0; i += 4
+                    continue
+                }
+                if (word == "for" || word == "while" || word == "do") {
+                    k = slot++
+                    loop_kind[k] = word; loop_line[k] = NR; loop_func[k] = func_name; loop_brace[k] = 2; enter_col[k] = i
+                    loop_bound[k] = bound_of(substr(code, i), $0, prev)
+                    if (word == "do") { body_k = k } else { header_k = k; header_tail = 0; header_parens = 0 }
+                }
+                if (word != "") { i += length(word) - 1; continue }
+                if (c == "{") { d++ }
+                else if (c == "}") {
+                    d--
+                    while (open_loops > 0 && d <= loop_depth[open_loops]) {
+                        k = loop_stack[open_loops--]
+                        if (loop_kind[k] == "do") { do_tail = k } else { loop_end[k] = NR; close_col[k] = i }
+                    }
+                }
+            }
+        }
+        # Tarjan: a function is recursive when its strongly connected component has a cycle
+        function strong(v,    i, w, size) {
+            low[v] = visit[v] = ++visits
+            scc[++scc_top] = v; on_scc[v] = 1
+            for (i = 1; i <= degree[v]; i++) {
+                w = callee[v, i]
+                if (w == v) { recursive[v] = 1 }
+                if (!(w in visit)) {
+                    strong(w)
+                    if (low[w] < low[v]) { low[v] = low[w] }
+                } else if (on_scc[w] && visit[w] < low[v]) {
+                    low[v] = visit[w]
+                }
+            }
+            if (low[v] == visit[v]) {
+                size = 0
+                do { w = scc[scc_top--]; on_scc[w] = 0; members[++size] = w } while (w != v)
+                if (size > 1) { for (i = 1; i <= size; i++) { recursive[members[i]] = 1 } }
+            }
+        }
+        # Depth first, memoized per function; a back edge (a function still on the path) makes the depth unbounded
+        function stack_depth(fn,    i, d, best) {
+            if (colour[fn] == 2) { return depth_of[fn] }
+            if (colour[fn] == 1) { return -1 }
+            colour[fn] = 1
+            best = 0
+            for (i = 1; i <= degree[fn]; i++) {
+                d = stack_depth(callee[fn, i])
+                if (d < 0) { best = -1; break }
+                if (d > best) { best = d }
+            }
+            colour[fn] = 2
+            depth_of[fn] = best < 0 ? -1 : stack[fn] + best
+            return depth_of[fn]
+        }
+        BEGIN {
+            print "#astroguard-ir", version, key
+            slot = 0
+            header_k = body_k = semi_k = do_tail = do_statement = ""
+        }
+        {
+            code = strip($0)
+
+            if (depth == 0 && code ~ /[A-Za-z_][A-Za-z0-9_]*[ \t]*\(/ && code !~ /;[ \t]*$/) {
+                match(code, /[A-Za-z_][A-Za-z0-9_]*[ \t]*\(/)
+                pending = substr(code, RSTART, RLENGTH)
+                sub(/[ \t]*\($/, "", pending)
+                pending_line = NR
+            }
+
+            if (code !~ /^[ \t]*#/) { scan_loops(code) }
+
+            opened = gsub(/\{/, "{", code)
+            closed = gsub(/\}/, "}", code)
+            if (depth == 0 && opened > 0 && pending != "") {
+                func_name = pending; func_start = pending_line; pending = ""
+            }
+            depth += opened - closed
+            if (depth == 0 && func_name != "" && closed > 0) {
+                order[++n] = func_name; start[func_name] = func_start; end[func_name] = NR
+                func_name = ""
+            }
+            prev = $0
+        }
+        END {
+            while ((getline line < graph) > 0) {
+                # Static functions are titled "file:name" in the call graph
+                if (line ~ /^node: /) {
+                    name = line; sub(/.*title: "/, "", name); sub(/".*/, "", name); sub(/.*:/, "", name)
+                    if (match(line, /[0-9]+ bytes/)) { stack[name] = substr(line, RSTART, RLENGTH) + 0 }
+                } else if (line ~ /^edge: /) {
+                    a = line; sub(/.*sourcename: "/, "", a); sub(/".*/, "", a); sub(/.*:/, "", a)
+                    b = line; sub(/.*targetname: "/, "", b); sub(/".*/, "", b); sub(/.*:/, "", b)
+                    at = line; sub(/.*label: "/, "", at); sub(/".*/, "", at)
+                    k = split(at, parts, ":"); at = parts[k - 1]
+                    ne++; src[ne] = a; dst[ne] = b; edges[ne] = a "\t" b "\t" at
+                }
+            }
+            for (k = 0; k < slot; k++) {
+                if (!(k in loop_end) || !(k in open_col)) { loop_brace[k] = 2 }
+                printf "L\t%d\t%d\t%s\t%s\t%d\t%d\t%d\t%d\t%d\t%d\n", k, loop_line[k], loop_func[k], loop_bound[k], loop_brace[k], loop_end[k], enter_col[k], open_line[k], open_col[k], close_col[k]
+            }
+            # Calls between functions of this file, once per caller and callee
+            for (i = 1; i <= ne; i++) {
+                if (!(dst[i] in start) || ((src[i], dst[i]) in linked)) { continue }
+                linked[src[i], dst[i]] = 1
+                callee[src[i], ++degree[src[i]]] = dst[i]
+            }
+            for (i = 1; i <= n; i++) { if (!(order[i] in visit)) { strong(order[i]) } }
+            for (i = 1; i <= n; i++) {
+                fn = order[i]
+                printf "F\t%s\t%d\t%d\t%d\t%d\t%d\n", fn, start[fn], end[fn], stack[fn], recursive[fn] ? 1 : 0, stack_depth(fn)
+            }
+            for (i = 1; i <= ne; i++) { print "C\t" edges[i] }
+        }
+    ' "${file_path}" > "${ir_tmp}"
+
+    # Concurrent runs on the same source produce identical files, the last rename wins
+    cp "${ir_tmp}" "${ir_file}"
+    mv "${ir_tmp}" "${cached}"
+    cache_evict "${ir_dir}"
+}
+
+# Optional Step (-l)
+# Loop iteration profiling for Rule 2
+# Builds an instrumented copy of the input where every loop owns a counter slot (see runtime/loop_profile.h)
+# Observed iteration maxima are compared with the static bound or a declared "@bound N" annotation
+
+loop_profile() {
+    print_color "Step 2.1 > Profiling Loop Iterations" cyan
+    local loop_src="${file_path_no_ext}_loops.c"
+    local loop_map="${file_path_no_ext}.loopmap"
+    local loop_out="${file_path_no_ext}.loops"
+
+    awk -F '\t' '$1 == "L" { print $2, $3, $4, $5, $6 }' "${ir_file}" > "${loop_map}"
+
+    # Instrument the loops of the IR with a braced body at the columns the IR found for them
+    # Each instrumented loop is wrapped in its own block so an unbraced if or else still guards the whole loop
+    # Line numbers are preserved so results map straight back to the input file
+    awk -v ir="${ir_file}" '
+        function insert(line_no, col, first, text) {
+            n = ++inserts[line_no]
+            ins_col[line_no, n] = col; ins_first[line_no, n] = first; ins_text[line_no, n] = text
+        }
+        BEGIN {
+            while ((getline line < ir) > 0) {
+                split(line, f, "\t")
+                if (f[1] != "L" || f[6] == 2) { continue }
+                insert(f[3], f[8], 1, "{ AG_LOOP_ENTER(" f[2] "); ")
+                insert(f[9], f[10] + 1, 0, " AG_LOOP_TICK(" f[2] ");")
+                insert(f[7], f[11] + 1, 0, " }")
+            }
+        }
+        {
+            line = $0
+            if (NR in inserts) {
+                # Right to left so earlier columns stay valid, the block opening goes in first at a shared column
+                m = inserts[NR]
+                for (i = 1; i <= m; i++) { done[i] = 0 }
+                for (j = 1; j <= m; j++) {
+                    best = 0
+                    for (i = 1; i <= m; i++) {
+                        if (done[i]) { continue }
+                        if (!best || ins_col[NR, i] > ins_col[NR, best] || (ins_col[NR, i] == ins_col[NR, best] && ins_first[NR, i] > ins_first[NR, best])) { best = i }
+                    }
+                    done[best] = 1
+                    c = ins_col[NR, best]
+                    line = substr(line, 1, c - 1) ins_text[NR, best] substr(line, c)
+                }
+            }
+            print line
+        }
+    ' "${file_path}" > "${loop_src}"
+
+    local slots
+    slots=$(wc -l < "${loop_map}")
+    if [ "${slots}" -eq 0 ]; then
+        print_color "No loops found to profile."
+        return
+    fi
+
+    gcc -std=iso9899:1999 -DAG_LOOP_SLOTS="${slots}" -include "./runtime/loop_profile.h" "${loop_src}" -o "${file_path_no_ext}_loops"
+    AG_LOOP_OUT="${loop_out}" "${file_path_no_ext}_loops" > /dev/null
+
+    # Join the slot map (slot line function bound) with the dump (slot entries total max)
+    awk -v file="${file_name}" '
+        NR == FNR { line[$1] = $2; func_name[$1] = $3; bound[$1] = $4; brace[$1] = $5; next }
+        {
+            where = file ":" line[$1] " " func_name[$1]
+            stats = "entries=" $2 " total=" $3 " max=" $4 " bound=" bound[$1]
+            if (brace[$1] == 2) { status = "yellow NOT-INSTRUMENTED" }
+            else if ($2 == 0) { status = "yellow NOT-REACHED" }
+            else if (bound[$1] == "-") { status = "yellow UNBOUNDED" }
+            else if ($4 + 0 > bound[$1] + 0) { status = "red EXCEEDED" }
+            else { status = "green OK" }
+            split(status, s, " ")
+            print s[1], s[2] " " where " " stats
+        }
+    ' "${loop_map}" "${loop_out}" | while read -r color result; do
+        print_color "${result}" "${color}"
+    done
+}
+
+# Rule findings
+# Turns the compiler diagnostics captured in compile() into "line rule flag message" records
+# Warnings are Rule 10 findings unless their flag points at a more specific rule
+# Recursion (Rule 1) and function length (Rule 4) are checked on the IR
+
+findings() {
+    awk -v src="${file_path}" '
+        index($0, src ":") == 1 && $0 ~ /: (warning|error): / {
+            rest = substr($0, length(src) + 2)
+            split(rest, pos, ":")
+            message = rest
+            sub(/^[0-9]+:[0-9]+: (warning|error): /, "", message)
+            flag = "-"
+            if (match(message, /\[-W[^]]*\]$/)) {
+                flag = substr(message, RSTART + 1, RLENGTH - 2)
+                message = substr(message, 1, RSTART - 2)
+            }
+            rule = 10
+            if (flag == "-Wshadow") { rule = 6 }
+            else if (flag == "-Wunused-result" || flag == "-Wunused-value") { rule = 7 }
+            else if (flag == "-Wpointer-arith") { rule = 9 }
+            printf "%s\t%s\t%s\t%s\n", pos[1], rule, flag, message
+        }
+    ' "${file_path_no_ext}.diag" > "${file_path_no_ext}.findings"
+
+    awk -F '\t' '
+        $1 == "F" { order[++n] = $2; start[$2] = $3; end[$2] = $4; recursive[$2] = $6 }
+        END {
+            for (i = 1; i <= n; i++) {
+                fn = order[i]
+                if (recursive[fn]) {
+                    printf "%d\t1\t-\tfunction \047%s\047 is part of a recursive call chain\n", start[fn], fn
+                }
+                if (end[fn] - start[fn] + 1 > 60) {
+                    printf "%d\t4\t-\tfunction \047%s\047 is %d lines long, more than a printed page (60)\n", start[fn], fn, end[fn] - start[fn] + 1
+                }
+            }
+        }
+    ' "${ir_file}" >> "${file_path_no_ext}.findings"
+
+    # In diff mode only the findings on changed lines or inside the audited functions are kept
+    if [ -n "${diff_range}" ]; then
+        awk -F '\t' -v changed="${file_path_no_ext}.changed" '
+            BEGIN { while ((getline line < changed) > 0) { touched[line + 0] = 1 } }
+            NR == FNR { start[FNR] = $2; end[FNR] = $3; n = FNR; next }
+            $1 + 0 in touched { print; next }
+            { for (i = 1; i <= n; i++) { if ($1 + 0 >= start[i] && $1 + 0 <= end[i]) { print; next } } }
+        ' "${file_path_no_ext}.scope" "${file_path_no_ext}.findings" > "${file_path_no_ext}.findings.tmp"
+        mv "${file_path_no_ext}.findings.tmp" "${file_path_no_ext}.findings"
+    fi
+}
+
+# Function table
+# Extracts "name start end calls lines lines_hit" records for every function from the gcov JSON output
+
+function_table() {
+    gcov -t -j -o "$(dirname -- "${file_path}")" "${file_path}" 2> /dev/null | awk '
+        function field(rec, key,    v) {
+            if (!match(rec, "\"" key "\": [^,}]*")) { return "" }
+            v = substr(rec, RSTART + length(key) + 4, RLENGTH - length(key) - 4)
+            gsub(/"/, "", v)
+            return v
+        }
+        BEGIN { RS = "{" }
+        /"line_number"/ {
+            name = field($0, "function_name")
+            lines[name]++
+            if (field($0, "count") + 0 > 0) { hit[name]++ }
+        }
+        /"start_line"/ {
+            name = field($0, "name")
+            order[++n] = name
+            start[name] = field($0, "start_line")
+            end[name] = field($0, "end_line")
+            calls[name] = field($0, "execution_count")
+        }
+        END {
+            for (i = 1; i <= n; i++) {
+                name = order[i]
+                printf "%s\t%s\t%s\t%s\t%d\t%d\n", name, start[name], end[name], calls[name], lines[name], hit[name]
+            }
+        }
+    ' > "${file_path_no_ext}.functions"
+}
+
+# Optional Step (-d)
+# Git-diff-scoped audit
+# Maps the hunks changed in a git revision range to the enclosing functions of the input file
+# Only those functions and their call graph neighbours are audited, and coverage is reported on changed lines only
+
+diff_lines() {
+    print_color "Step 1.1 > Collecting Changes in ${diff_range}" cyan
+    local dir
+    dir=$(dirname -- "${file_path}")
+
+    # Hunks are always taken against the working tree, the file that is compiled and run
+    # A range is diffed from its base, and is only audited when the working tree matches its tip
+    local base="${diff_range}"
+    local tip=""
+    if [[ "${diff_range}" == *...* ]]; then
+        tip="${diff_range#*...}"
+        base=$(git -C "${dir}" merge-base "${diff_range%%...*}" "${tip:-HEAD}")
+    elif [[ "${diff_range}" == *..* ]]; then
+        tip="${diff_range#*..}"
+        base="${diff_range%%..*}"
+    fi
+    if [[ "${diff_range}" == *..* ]] && ! git -C "${dir}" diff --quiet "${tip:-HEAD}" -- "${file_name}"; then
+        if [ "$(git -C "${dir}" rev-parse "${tip:-HEAD}^{commit}")" != "$(git -C "${dir}" rev-parse HEAD)" ]; then
+            print_color "${file_name} differs from ${tip}, check out ${tip} before auditing ${diff_range}." red
+            exit 1
+        fi
+        print_color "${file_name} has uncommitted changes, they are audited along with ${diff_range}." yellow
+    fi
+
+    git -C "${dir}" diff -U0 --no-color "${base:-HEAD}" -- "${file_name}" | awk '
+        /^@@ / {
+            split($3, hunk, ",")
+            first = substr(hunk[1], 2) + 0
+            count = (2 in hunk) ? hunk[2] + 0 : 1
+            # A pure deletion still touches the function around the line it was removed after
+            if (count == 0) { count = 1 }
+            for (i = 0; i < count; i++) { print first + i }
+        }
+    ' > "${file_path_no_ext}.changed"
+
+    if [ ! -s "${file_path_no_ext}.changed" ]; then
+        print_color "No changes to ${file_name} in ${diff_range}, nothing to audit." green
+        exit 0
+    fi
+    print_color "$(wc -l < "${file_path_no_ext}.changed") changed lines"
+}
+
+diff_scope() {
+    print_color "Step 3.1 > Scoping Audit to Changed Functions" cyan
+
+    # Changed functions of the IR, plus their callers and callees for the Rule 1 and stack checks
+    awk -F '\t' -v changed="${file_path_no_ext}.changed" '
+        BEGIN { while ((getline line < changed) > 0) { touched[line + 0] = 1 } }
+        $1 == "C" { nedges++; src[nedges] = $2; dst[nedges] = $3 }
+        $1 == "F" {
+            start[$2] = $3; end[$2] = $4; recursive[$2] = $6; depth[$2] = $7; order[++n] = $2
+            for (l = $3; l <= $4; l++) { if (l in touched) { hit[$2] = 1; break } }
+        }
+        END {
+            for (i = 1; i <= nedges; i++) {
+                if (hit[src[i]] && (dst[i] in start)) { scope[dst[i]] = 1 }
+                if (hit[dst[i]] && (src[i] in start)) { scope[src[i]] = 1 }
+            }
+            for (i = 1; i <= n; i++) {
+                fn = order[i]
+                if (!hit[fn] && !scope[fn]) { continue }
+                printf "%s\t%s\t%s\t%s\n", fn, start[fn], end[fn], hit[fn] ? "changed" : "neighbour" > "/dev/stderr"
+                if (recursive[fn]) { print "red Rule 1: " fn " is part of a recursive call chain" }
+                d = depth[fn]
+                if (d < 0) { print "red Stack: " fn " has unbounded stack depth (recursion)" }
+                else { print "green Stack: " fn " worst-case stack depth " d " bytes" }
+            }
+        }
+    ' "${ir_file}" 2> "${file_path_no_ext}.scope" | while read -r color result; do
+        print_color "${result}" "${color}"
+    done
 }
 
 # Step #3
@@ -131,6 +873,129 @@ coverage() {
     gcov "${file_name}"
 }
 
+# Optional Step (-m)
+# MC/DC coverage for flight software certification
+# Built on GCC condition coverage (-fcondition-coverage, gcov --conditions)
+# Each decision keeps two bitsets, the conditions shown to independently take the decision true and false
+# The bitsets are OR-merged into file.mcdc so coverage accumulates across runs until the source changes
+
+mcdc_coverage() {
+    print_color "Step 3.2 > Computing MC/DC Coverage" cyan
+    local ledger="${file_path_no_ext}.mcdc"
+    local source_hash
+    source_hash=$(sha256sum < "${file_path}" | cut -c 1-16)
+
+    function_table
+
+    gcov -t --conditions -o "$(dirname -- "${file_path}")" "${file_path}" 2> /dev/null | awk -v ledger="${ledger}" -v hash="${source_hash}" -v fns="${file_path_no_ext}.functions" -v file="${file_name}" '
+        function nibble_or(a, b,    r, bit) {
+            r = 0
+            for (bit = 8; bit >= 1; bit /= 2) {
+                if (a >= bit || b >= bit) { r += bit }
+                if (a >= bit) { a -= bit }
+                if (b >= bit) { b -= bit }
+            }
+            return r
+        }
+        # Bitsets are hex strings, least significant condition in the last digit
+        function mask_or(a, b,    r, i, da, db) {
+            while (length(a) < length(b)) { a = "0" a }
+            while (length(b) < length(a)) { b = "0" b }
+            r = ""
+            for (i = 1; i <= length(a); i++) {
+                da = index(HEX, substr(a, i, 1)) - 1
+                db = index(HEX, substr(b, i, 1)) - 1
+                r = r substr(HEX, nibble_or(da, db) + 1, 1)
+            }
+            return r
+        }
+        function mask_of(bits, n,    r, i, d, v) {
+            r = ""
+            for (i = 0; i < n; i += 4) {
+                v = 0
+                for (d = 3; d >= 0; d--) { v = v * 2 + ((i + d) < n && bits[i + d]) }
+                r = substr(HEX, v + 1, 1) r
+            }
+            return r
+        }
+        function popcount(mask,    i, v, c) {
+            c = 0
+            for (i = 1; i <= length(mask); i++) {
+                v = index(HEX, substr(mask, i, 1)) - 1
+                while (v > 0) { c += v % 2; v = int(v / 2) }
+            }
+            return c
+        }
+        function flush(    i) {
+            if (terms == 0) { return }
+            for (i = 0; i < terms; i++) { tbits[i] = !(i in miss_true); fbits[i] = !(i in miss_false) }
+            key = line_no "." seq++
+            if (key in n_terms) {
+                true_mask[key] = mask_or(true_mask[key], mask_of(tbits, terms))
+                false_mask[key] = mask_or(false_mask[key], mask_of(fbits, terms))
+            } else {
+                order[++decisions] = key
+                n_terms[key] = terms
+                true_mask[key] = mask_of(tbits, terms)
+                false_mask[key] = mask_of(fbits, terms)
+            }
+            terms = 0
+            delete miss_true; delete miss_false
+        }
+        BEGIN {
+            HEX = "0123456789abcdef"
+            while ((getline line < fns) > 0) { split(line, f, "\t"); nfn++; fname[nfn] = f[1]; fstart[nfn] = f[2]; fend[nfn] = f[3] }
+            # Carry over the bitsets of previous runs while the source is unchanged
+            if ((getline line < ledger) > 0 && line == "# " hash) {
+                while ((getline line < ledger) > 0) {
+                    split(line, f, " ")
+                    order[++decisions] = f[1]; n_terms[f[1]] = f[2]; true_mask[f[1]] = f[3]; false_mask[f[1]] = f[4]
+                }
+            }
+            close(ledger)
+        }
+        /^ *([0-9]+\*?|#####|=====|-):  *[0-9]+:/ {
+            flush()
+            split($0, f, ":")
+            line_no = f[2] + 0
+            seq = 0
+            next
+        }
+        /^condition outcomes covered / {
+            flush()
+            split($4, f, "/")
+            terms = f[2] / 2
+            next
+        }
+        /^condition +[0-9]+ not covered/ {
+            idx = $2 + 0
+            if ($0 ~ /\(true/) { miss_true[idx] = 1 }
+            if ($0 ~ /false\)/) { miss_false[idx] = 1 }
+            next
+        }
+        END {
+            flush()
+            print "# " hash > ledger
+            full = 0; got = 0; want = 0
+            for (i = 1; i <= decisions; i++) {
+                key = order[i]
+                print key, n_terms[key], true_mask[key], false_mask[key] > ledger
+                covered = popcount(true_mask[key]) + popcount(false_mask[key])
+                got += covered; want += 2 * n_terms[key]
+                where = "-"
+                split(key, at, ".")
+                for (j = 1; j <= nfn; j++) { if (at[1] + 0 >= fstart[j] + 0 && at[1] + 0 <= fend[j] + 0) { where = fname[j] } }
+                if (covered == 2 * n_terms[key]) { full++; color = "green"; status = "MC/DC met" }
+                else { color = "red"; status = "MC/DC not met" }
+                printf "%s %s:%d %s conditions=%d outcomes=%d/%d %s\n", color, file, at[1], where, n_terms[key], covered, 2 * n_terms[key], status
+            }
+            printf "blue Decisions with full MC/DC: %d of %d, condition outcomes covered: %d of %d\n", full, decisions, got, want
+        }
+    ' | while read -r color result; do
+        print_color "${result}" "${color}"
+    done
+}
+
 # Step #4
 # Generate line coverage report using lcov
 
@@ -139,21 +1004,536 @@ line_coverage() {
     lcov -c --directory . --output-file main_coverage.info
 }
 
+# Optional Step (-d)
+# Restricts the tracefile to the changed lines of the input file
+
+diff_coverage() {
+    print_color "Step 4.2 > Filtering Coverage to Changed Lines" cyan
+    coverage_info="diff_coverage.info"
+    awk -v changed="${file_path_no_ext}.changed" -v src="$(realpath -- "${file_path}")" '
+        BEGIN { while ((getline line < changed) > 0) { touched[line + 0] = 1 } }
+        /^SF:/ { keep = (substr($0, 4) == src); lf = lh = 0 }
+        !keep { next }
+        /^DA:/ {
+            split(substr($0, 4), f, ",")
+            if (!(f[1] + 0 in touched)) { next }
+            lf++; if (f[2] + 0 > 0) { lh++ }
+        }
+        /^LF:/ { print "LF:" lf; next }
+        /^LH:/ { print "LH:" lh; printf "Changed lines covered: %d of %d\n", lh, lf > "/dev/stderr"; next }
+        { print }
+    ' main_coverage.info > "${coverage_info}"
+}
+
+# Optional Step (-u)
+# Coverage-informed dead code and flash size report
+# Rebuilds the input with one section per function and data object and lets the linker drop unreferenced ones
+# Every function is classified as statically unreachable (dropped by --gc-sections), linked but never executed, or executed
+# A never executed function is credited with the callees of the IR call graph that only it keeps alive
+
+dead_code() {
+    print_color "Step 4.3 > Ranking Dead Code by Flash Size" cyan
+    local sections_obj="${file_path_no_ext}_sections.o"
+
+    # Warnings repeat those of compile(), so the output is only shown when the build fails
+    if ! gcc -std=iso9899:1999 -ffunction-sections -fdata-sections -c "${file_path}" -o "${sections_obj}" 2> "${file_path_no_ext}_sections.diag"; then
+        cat "${file_path_no_ext}_sections.diag" >&2
+        print_color "Compilation failed." red
+        exit 1
+    fi
+    if ! gcc "${sections_obj}" -Wl,--gc-sections -Wl,--print-gc-sections -o "${file_path_no_ext}_sections" 2> "${file_path_no_ext}.gc"; then
+        grep -v "removing unused section" "${file_path_no_ext}.gc" >&2 || true
+        print_color "Compilation failed." red
+        exit 1
+    fi
+
+    function_table
+
+    readelf -SW "${sections_obj}" | awk -v gc="${file_path_no_ext}.gc" -v fns="${file_path_no_ext}.functions" -v ir="${ir_file}" '
+        BEGIN {
+            while ((getline line < gc) > 0) {
+                if (match(line, /removing unused section \047[^\047]*\047/)) {
+                    name = substr(line, RSTART + 25, RLENGTH - 26)
+                    removed[name] = 1
+                }
+            }
+            while ((getline line < fns) > 0) { split(line, f, "\t"); calls[f[1]] = f[4] + 0; known[f[1]] = 1 }
+            while ((getline line < ir) > 0) {
+                split(line, f, "\t")
+                if (f[1] == "C" && f[2] != f[3]) { ne++; src[ne] = f[2]; dst[ne] = f[3] }
+            }
+        }
+        # [Nr] Name Type Address Off Size ... for the per-symbol .text/.data/.bss/.rodata sections
+        match($0, /\] \.(text|data|bss|rodata)\.[^ ]+/) {
+            section = substr($0, RSTART + 2, RLENGTH - 2)
+            split(substr($0, RSTART + RLENGTH), f, " ")
+            symbol = section; sub(/^\.(text|data|bss|rodata)\./, "", symbol)
+            size[symbol] += hex(f[4])
+            is_text[symbol] = (section ~ /^\.text\./)
+            if (section in removed) { dropped[symbol] = 1 }
+            order[++n] = symbol
+        }
+        function hex(h,    i, v) {
+            v = 0
+            for (i = 1; i <= length(h); i++) { v = v * 16 + index("0123456789abcdef", substr(tolower(h), i, 1)) - 1 }
+            return v
+        }
+        END {
+            for (i = 1; i <= n; i++) {
+                fn = order[i]
+                if (fn in seen) { continue }
+                seen[fn] = 1
+                if (dropped[fn]) {
+                    printf "%d\tunreachable\t%s\t%s\n", size[fn], is_text[fn] ? "function" : "data", fn
+                    continue
+                }
+                if (!is_text[fn] || !(fn in known)) { continue }
+                if (calls[fn] > 0) {
+                    printf "%d\texecuted\tfunction\t%s\n", 0, fn
+                    continue
+                }
+                # Grow the set of functions only reachable through fn until it stops changing
+                delete keep
+                keep[fn] = 1
+                saved = size[fn]
+                grown = 1
+                while (grown) {
+                    grown = 0
+                    for (e = 1; e <= ne; e++) {
+                        g = dst[e]
+                        if ((g in keep) || !(g in known) || dropped[g] || g == "main" || !(src[e] in keep)) { continue }
+                        only = 1
+                        for (k = 1; k <= ne; k++) { if (dst[k] == g && !(src[k] in keep) && !dropped[src[k]]) { only = 0; break } }
+                        if (only) { keep[g] = 1; saved += size[g]; grown = 1 }
+                    }
+                }
+                printf "%d\tnever-executed\tfunction\t%s\n", saved, fn
+            }
+        }
+    ' | sort -t "$(printf '\t')" -k1,1 -n -r > "${file_path_no_ext}.deadcode"
+
+    printf "%10s  %-15s %-9s %s\n" "BYTES" "CLASS" "KIND" "SYMBOL"
+    while IFS=$'\t' read -r bytes class kind symbol; do
+        local color="green"
+        if [ "${class}" == "never-executed" ]; then
+            color="red"
+        elif [ "${class}" == "unreachable" ]; then
+            color="yellow"
+        fi
+        print_color "$(printf "%10s  %-15s %-9s %s" "${bytes}" "${class}" "${kind}" "${symbol}")" "${color}"
+    done < "${file_path_no_ext}.deadcode"
+}
+
+# Optional Step (-p)
+# Function-level hot-path profile
+# Rebuilds the input with -finstrument-functions and the ring buffer recorder in runtime/func_profile.c
+# Call counts and inclusive/exclusive time are joined with line coverage and rule findings per function
+
+profile() {
+    print_color "Step 4.1 > Profiling Function Hot Paths" cyan
+    local prof_bin="${file_path_no_ext}_profile"
+    local prof_out="${file_path_no_ext}.prof"
+
+    gcc -std=iso9899:1999 -no-pie -finstrument-functions "${file_path}" "./runtime/func_profile.c" -o "${prof_bin}"
+    AG_PROF_OUT="${prof_out}" "${prof_bin}" > /dev/null
+
+    findings
+    function_table
+
+    # Symbolize the recorded addresses, then join on function name
+    # Output is sorted by inclusive time so violations on hot paths come first
+    nm "${prof_bin}" | awk '$2 ~ /^[tT]$/ { address = $1; sub(/^0+/, "", address); printf "%s\t%s\n", address, $3 }' > "${prof_bin}.syms"
+
+    awk -F '\t' -v syms="${prof_bin}.syms" -v prof="${prof_out}" -v fnd="${file_path_no_ext}.findings" '
+        BEGIN {
+            while ((getline line < syms) > 0) { split(line, f, "\t"); sym[f[1]] = f[2] }
+            while ((getline line < prof) > 0) {
+                split(line, f, " ")
+                name = sym[f[1]]
+                calls[name] = f[2]; incl[name] = f[3]; excl[name] = f[4]
+            }
+            nf = 0
+            while ((getline line < fnd) > 0) { split(line, f, "\t"); fline[++nf] = f[1]; frule[nf] = f[2] }
+        }
+        {
+            name = $1
+            count = 0; rules = ""
+            for (i = 1; i <= nf; i++) {
+                if (fline[i] + 0 >= $2 + 0 && fline[i] + 0 <= $3 + 0) {
+                    count++
+                    if (index(rules, "R" frule[i] ",") == 0) { rules = rules "R" frule[i] "," }
+                }
+            }
+            sub(/,$/, "", rules)
+            if (rules == "") { rules = "-" }
+            coverage = $5 > 0 ? 100 * $6 / $5 : 0
+            printf "%s\t%d\t%.3f\t%.3f\t%.1f\t%d\t%s\n", name, calls[name], incl[name] / 1e6, excl[name] / 1e6, coverage, count, rules
+        }
+    ' "${file_path_no_ext}.functions" | sort -t "$(printf '\t')" -k3,3 -g -r > "${file_path_no_ext}.profile"
+
+    printf "%-32s %8s %12s %12s %8s %9s %s\n" "FUNCTION" "CALLS" "INCL(ms)" "EXCL(ms)" "COV(%)" "FINDINGS" "RULES"
+    while IFS=$'\t' read -r name calls incl excl cov count rules; do
+        local color="green"
+        if [ "${count}" -gt 0 ] && [ "${calls}" -gt 0 ]; then
+            color="red"
+        elif [ "${count}" -gt 0 ]; then
+            color="yellow"
+        fi
+        print_color "$(printf "%-32s %8s %12s %12s %8s %9s %s" "${name}" "${calls}" "${incl}" "${excl}" "${cov}" "${count}" "${rules}")" "${color}"
+    done < "${file_path_no_ext}.profile"
+}
+
 # Step #5
-# Generate HTML coverage report using genhtml
+# Generate HTML and SARIF report
+# Streams the tracefile (main_coverage.info, or diff_coverage.info with -d) one record at a time and writes one page per source file into out/
+# A page is only rewritten when the hash of its coverage record, source and findings changed since the last run
+# The findings are also written as a single SARIF document (out/astroguard.sarif) for CI ingestion
+
+gen_report() {
+    print_color "Step 5 > Generating HTML and SARIF Report" cyan
+    local out_dir="out"
+    local source_hashes="${out_dir}/.sources"
+    mkdir -p "${out_dir}"
+    touch "${out_dir}/.manifest"
+
+    findings
+
+    # Hash every source file named in the tracefile with a single sha256sum call
+    awk -F ':' '/^SF:/ { print substr($0, 4) }' "${coverage_info}" | tr '\n' '\0' | xargs -0 -r sha256sum > "${source_hashes}" 2> /dev/null || true
+    local findings_hash
+    findings_hash=$(sha256sum < "${file_path_no_ext}.findings" | cut -c 1-16)
+
+    awk -v out="${out_dir}" -v src="$(realpath -- "${file_path}")" -v fnd="${file_path_no_ext}.findings" -v fnd_sum="${findings_hash}" -v sums="${source_hashes}" -v version="${report_version}" '
+        function esc(text) {
+            gsub(/&/, "\\&amp;", text); gsub(/</, "\\&lt;", text); gsub(/>/, "\\&gt;", text)
+            return text
+        }
+        function mix(h, v) { return (h * 31 + v) % 1000000007 }
+        function page_of(path,    p) { p = path; gsub(/[^A-Za-z0-9._-]/, "_", p); return p ".html" }
+        function exists(file,    line) {
+            if ((getline line < file) < 0) { return 0 }
+            close(file)
+            return 1
+        }
+        BEGIN {
+            while ((getline line < (out "/.manifest")) > 0) { split(line, f, " "); old[f[1]] = f[2] }
+            while ((getline line < sums) > 0) { sum[substr(line, 67)] = substr(line, 1, 16) }
+            while ((getline line < fnd) > 0) {
+                split(line, f, "\t")
+                nf++; fline[nf] = f[1]; frule[nf] = f[2]; fmsg[nf] = f[4] (f[3] != "-" ? " [" f[3] "]" : "")
+            }
+            print "<html><head><title>astroguard report</title></head><body><h1>astroguard report</h1><table>" > (out "/index.html.tmp")
+            print "<tr><th>File</th><th>Lines</th><th>Functions</th><th>Findings</th></tr>" > (out "/index.html.tmp")
+            printf "" > (out "/.manifest.tmp")
+        }
+        /^SF:/ { path = substr($0, 4); h = 0; delete da; delete fn_hit; lf = lh = fnf = fnh = 0; next }
+        /^DA:/ { split(substr($0, 4), f, ","); da[f[1]] = f[2]; h = mix(mix(h, f[1]), f[2] % 1000000007); next }
+        /^FNDA:/ { split(substr($0, 6), f, ","); h = mix(h, f[1] % 1000000007); next }
+        /^LF:/ { lf = substr($0, 4); next }
+        /^LH:/ { lh = substr($0, 4); next }
+        /^FNF:/ { fnf = substr($0, 5); next }
+        /^FNH:/ { fnh = substr($0, 5); next }
+        /^end_of_record/ {
+            page = page_of(path)
+            count = 0
+            key = version "-" sum[path] "-" h
+            if (path == src) {
+                count = nf
+                key = key "-" fnd_sum
+            }
+            manifest[page] = key
+            printf "<tr><td><a href=\"%s\">%s</a></td><td>%d/%d</td><td>%d/%d</td><td>%d</td></tr>\n", page, esc(path), lh, lf, fnh, fnf, count > (out "/index.html.tmp")
+            file = out "/" page
+            if (old[page] == key && exists(file)) { kept++; next }
+
+            print "<html><head><title>" esc(path) "</title></head><body><h1>" esc(path) "</h1><pre>" > file
+            n = 0
+            while ((getline line < path) > 0) {
+                n++
+                note = ""
+                if (path == src) {
+                    for (i = 1; i <= nf; i++) { if (fline[i] == n) { note = note " <b>Rule " frule[i] ": " esc(fmsg[i]) "</b>" } }
+                }
+                color = (n in da) ? (da[n] > 0 ? "#cfc" : "#fcc") : "#fff"
+                hits = (n in da) ? da[n] : ""
+                printf "<span style=\"background:%s\">%6d %8s  %s</span>%s\n", color, n, hits, esc(line), note > file
+            }
+            close(path)
+            print "</pre></body></html>" > file
+            close(file)
+            written++
+        }
+        END {
+            print "</table></body></html>" > (out "/index.html.tmp")
+            for (page in manifest) { print page, manifest[page] > (out "/.manifest.tmp") }
+            for (page in old) { if (!(page in manifest)) { print page > (out "/.stale") } }
+            printf "%d pages written, %d unchanged\n", written, kept
+        }
+    ' "${coverage_info}"
+
+    mv "${out_dir}/index.html.tmp" "${out_dir}/index.html"
+    mv "${out_dir}/.manifest.tmp" "${out_dir}/.manifest"
+    if [ -f "${out_dir}/.stale" ]; then
+        (cd "${out_dir}" && xargs rm -f < .stale && rm -f .stale)
+    fi
 
-gen_html() {
-    print_color "Step 5 > Generating HTML Coverage Report" cyan
-    genhtml main_coverage.info --output-directory out
-    open "./${pwd}${dirname}/out/index.html"
+    # SARIF 2.1.0 document with one result per finding
+    awk -F '\t' -v uri="${file_path}" '
+        function json(text) { gsub(/\\/, "\\\\\\\\", text); gsub(/"/, "\\\"", text); return text }
+        BEGIN {
+            print "{\"version\": \"2.1.0\", \"$schema\": \"https://json.schemastore.org/sarif-2.1.0.json\", \"runs\": [{"
+            print "\"tool\": {\"driver\": {\"name\": \"astroguard\", \"informationUri\": \"https://github.com/ANG13T/astroguard\"}},"
+            printf "\"results\": ["
+        }
+        {
+            printf "%s\n{\"ruleId\": \"Rule %s\", \"level\": \"warning\", \"message\": {\"text\": \"%s%s\"}, ", (NR > 1 ? "," : ""), $2, json($4), ($3 != "-" ? " [" $3 "]" : "")
+            printf "\"locations\": [{\"physicalLocation\": {\"artifactLocation\": {\"uri\": \"%s\"}, \"region\": {\"startLine\": %d}}}]}", json(uri), $1
+        }
+        END { print "]}]}" }
+    ' "${file_path_no_ext}.findings" > "${out_dir}/astroguard.sarif"
+
+    if command -v open &> /dev/null; then
+        open "${out_dir}/index.html"
+    elif command -v xdg-open &> /dev/null; then
+        xdg-open "${out_dir}/index.html" &> /dev/null || true
+    fi
+}
+
+# Run history
+# Append-only columnar store of per-run and per-function results under .astroguard/history next to the input
+# (or $AG_HISTORY_DIR). Each column is its own file and a column index keeps the byte offset of every run,
+# so a query seeks straight to the rows of the runs it compares instead of reading the whole history.
+# Columns are plain files read with tail -c from the indexed offset, which seeks without memory-mapping them.
+#
+#   runs.{id,time,rev,tags,file}                     one row per run
+#   fn.{name,cov,len,depth,findings}                 one row per function and run, indexed per run in fn.*.idx
+#   finding.{func,rule,key}                          one row per finding and run, indexed per run in finding.*.idx
+#   finding.seen                                     first run a finding key appeared in (key rule function run time file)
+#   stage.{name,ms}                                  one row per stage and run, indexed per run in stage.*.idx
+
+now_ms() {
+    local ns
+    ns=$(date +%s%N)
+    if [[ "${ns}" =~ ^[0-9]+$ ]]; then
+        echo $((ns / 1000000))
+    else
+        echo $(($(date +%s) * 1000))
+    fi
+}
+
+# Runs a stage and keeps its wall time for the run history
+timed() {
+    local start
+    start=$(now_ms)
+    "$@"
+    stage_times+=("$1 $(($(now_ms) - start))")
 }
 
+history_path() {
+    echo "${AG_HISTORY_DIR:-$(dirname -- "${file_path}")/.astroguard/history}"
+}
+
+# Appends the rows read from stdin to a set of columns (one tab-separated field per column) and indexes them under run
+history_append() {
+    local dir="$1"
+    local run="$2"
+    shift 2
+    local rows
+    rows=$(cat)
+    local count=0
+    if [ -n "${rows}" ]; then
+        count=$(printf '%s\n' "${rows}" | wc -l)
+    fi
 
-while getopts "bBho:" flag; do
+    local i=1
+    for column in "$@"; do
+        touch "${dir}/${column}"
+        echo "${run} $(wc -c < "${dir}/${column}") ${count}" >> "${dir}/${column}.idx"
+        if [ "${count}" -gt 0 ]; then
+            printf '%s\n' "${rows}" | cut -f "${i}" >> "${dir}/${column}"
+        fi
+        i=$((i + 1))
+    done
+}
+
+# Prints the rows of a run from a column, seeking to its offset through the column index
+history_rows() {
+    local dir="$1"
+    local column="$2"
+    local run="$3"
+    local offset count
+    read -r offset count < <(awk -v run="${run}" '$1 == run { print $2, $3 }' "${dir}/${column}.idx")
+    if [ -n "${count}" ] && [ "${count}" -gt 0 ]; then
+        tail -c +$((offset + 1)) "${dir}/${column}" | head -n "${count}"
+    fi
+}
+
+history_record() {
+    print_color "Step 6 > Recording Run History" cyan
+    local dir
+    dir=$(history_path)
+    mkdir -p "${dir}"
+
+    until mkdir "${dir}/.lock" 2> /dev/null; do
+        break_stale_lock "${dir}/.lock"
+        sleep 0.1
+    done
+    trap 'rmdir "${dir}/.lock"' EXIT
+
+    local file
+    file=$(realpath -- "${file_path}")
+    local run=1
+    if [ -f "${dir}/runs.id" ]; then
+        run=$(($(wc -l < "${dir}/runs.id") + 1))
+    fi
+    local rev="-"
+    local tags="-"
+    if rev=$(git -C "$(dirname -- "${file_path}")" rev-parse HEAD 2> /dev/null); then
+        tags=$(git -C "$(dirname -- "${file_path}")" tag --points-at HEAD | paste -s -d ',' -)
+        tags=${tags:--}
+    else
+        rev="-"
+    fi
+
+    printf '%s\t%s\t%s\t%s\t%s\n' "${run}" "$(date +%s)" "${rev}" "${tags}" "${file}" | history_append "${dir}" "${run}" runs.id runs.time runs.rev runs.tags runs.file
+
+    function_table
+
+    # Per function: coverage from gcov, length and worst-case stack depth (-1 when unbounded) from the IR, findings inside its line range
+    # Finding keys start with the source path, since every file in a directory shares the same history
+    awk -F '\t' -v fns="${file_path_no_ext}.functions" -v fnd="${file_path_no_ext}.findings" -v out="${dir}/.findings.rows" -v file="${file}" '
+        BEGIN {
+            while ((getline line < fns) > 0) { split(line, f, "\t"); cov[f[1]] = f[5] > 0 ? sprintf("%.1f", 100 * f[6] / f[5]) : "0.0" }
+            while ((getline line < fnd) > 0) { nf++; findings[nf] = line }
+        }
+        $1 == "F" {
+            count = 0
+            for (i = 1; i <= nf; i++) {
+                split(findings[i], f, "\t")
+                if (f[1] + 0 >= $3 + 0 && f[1] + 0 <= $4 + 0) {
+                    count++
+                    print $2 "\t" f[2] "\t" file "|" $2 "|" f[2] "|" f[3] "|" f[4] > out
+                }
+            }
+            printf "%s\t%s\t%d\t%d\t%d\n", $2, ($2 in cov ? cov[$2] : "0.0"), $4 - $3 + 1, $7, count
+        }
+    ' "${ir_file}" | history_append "${dir}" "${run}" fn.name fn.cov fn.len fn.depth fn.findings
+
+    touch "${dir}/.findings.rows" "${dir}/finding.seen"
+    history_append "${dir}" "${run}" finding.func finding.rule finding.key < "${dir}/.findings.rows"
+
+    # Only keys never seen before are appended, so finding.seen grows with distinct findings, not with runs
+    awk -F '\t' -v run="${run}" -v now="$(date +%s)" -v seen="${dir}/finding.seen" -v file="${file}" '
+        BEGIN { while ((getline line < seen) > 0) { split(line, f, "\t"); known[f[1]] = 1 } }
+        !($3 in known) { known[$3] = 1; printf "%s\t%s\t%s\t%s\t%s\t%s\n", $3, $2, $1, run, now, file >> seen }
+    ' "${dir}/.findings.rows"
+    rm -f "${dir}/.findings.rows"
+
+    printf '%s\n' "${stage_times[@]}" | awk 'NF == 2 { print $1 "\t" $2 }' | history_append "${dir}" "${run}" stage.name stage.ms
+
+    rmdir "${dir}/.lock"
+    trap - EXIT
+    print_color "Recorded run ${run} in ${dir}"
+}
+
+# Queries:
+#   coverage-drop:<rev or tag>      functions whose coverage dropped between the last run at that revision and the latest run
+#   new-findings:<rule>[:<days>]    findings of a rule first seen in the last <days> days (default 7)
+
+history_query() {
+    local dir
+    dir=$(history_path)
+    local file
+    file=$(realpath -- "${file_path}")
+    if [ ! -f "${dir}/runs.id" ]; then
+        print_color "No run history in ${dir}." red
+        exit 1
+    fi
+
+    case "${history_query}" in
+        coverage-drop:*)
+            local ref="${history_query#coverage-drop:}"
+            local rev
+            rev=$(git -C "$(dirname -- "${file_path}")" rev-parse "${ref}^{commit}" 2> /dev/null || echo "${ref}")
+            local runs
+            runs=$(paste "${dir}/runs.id" "${dir}/runs.rev" "${dir}/runs.tags" "${dir}/runs.file" | awk -F '\t' -v file="${file}" -v rev="${rev}" -v ref="${ref}" '
+                $4 != file { next }
+                $2 == rev || index("," $3 ",", "," ref ",") > 0 { base = $1 }
+                { latest = $1 }
+                END { print base, latest }
+            ')
+            local base latest
+            read -r base latest <<< "${runs}"
+            if [ -z "${latest}" ] || [ -z "${base}" ]; then
+                print_color "No recorded run of ${file_name} at ${ref}." red
+                exit 1
+            fi
+            print_color "Coverage drops in ${file_name} between run ${base} (${ref}) and run ${latest}" cyan
+            awk -F '\t' '
+                FILENAME == ARGV[1] { before[$1] = $2; next }
+                ($1 in before) && $2 + 0 < before[$1] + 0 { printf "%s %.1f%% -> %.1f%%\n", $1, before[$1], $2 }
+            ' <(paste <(history_rows "${dir}" fn.name "${base}") <(history_rows "${dir}" fn.cov "${base}")) \
+              <(paste <(history_rows "${dir}" fn.name "${latest}") <(history_rows "${dir}" fn.cov "${latest}")) | while read -r result; do
+                print_color "${result}" red
+            done
+        ;;
+        new-findings:*)
+            local args="${history_query#new-findings:}"
+            local rule="${args%%:*}"
+            local days=7
+            if [ "${args}" != "${rule}" ]; then
+                days="${args#*:}"
+            fi
+            print_color "Rule ${rule} findings in ${file_name} first seen in the last ${days} days" cyan
+            awk -F '\t' -v rule="${rule}" -v since=$(($(date +%s) - days * 86400)) -v file="${file}" '
+                $6 == file && $2 == rule && $5 + 0 >= since { split($1, k, "|"); printf "run %s %s: %s\n", $4, $3, k[5] }
+            ' "${dir}/finding.seen" | while read -r result; do
+                print_color "${result}" yellow
+            done
+        ;;
+        *)
+            print_color "Unknown query: ${history_query}" red
+            about
+            exit 2
+        ;;
+    esac
+}
+
+while getopts "bBhlpumrq:d:s:o:" flag; do
   case $flag in
     b)
         hidebanner=1
     ;;
+    l)
+        loops=1
+    ;;
+    p)
+        profiling=1
+    ;;
+    u)
+        dead_code_report=1
+    ;;
+    r)
+        record_history=1
+    ;;
+    q)
+        history_query="$OPTARG"
+    ;;
+    m)
+        mcdc=1
+        coverage_flags+=(-fcondition-coverage)
+    ;;
+    d)
+        diff_range="$OPTARG"
+    ;;
+    s)
+        if ! [[ "$OPTARG" =~ ^[1-9][0-9]*$ ]]; then
+            print_color "Error: Snapshot interval must be a positive whole number of seconds." red
+            about
+            exit 2
+        fi
+        snapshot_interval="$OPTARG"
+    ;;
     h)
         about
         exit 1
@@ -183,11 +1563,41 @@ elif [ "${file_ext}" != "c" ]; then
     exit 1
 fi
 
+if [ -n "$history_query" ]; then
+    history_query
+    exit
+fi
+
 banner
 installation
-compile
-coverage
-line_coverage
-gen_html
+if [ -n "$diff_range" ]; then
+    timed diff_lines
+fi
+timed compile
+timed ir_load
+if [ $loops == 1 ]; then
+    timed loop_profile
+fi
+timed coverage
+if [ -n "$diff_range" ]; then
+    timed diff_scope
+fi
+if [ $mcdc == 1 ]; then
+    timed mcdc_coverage
+fi
+timed line_coverage
+if [ -n "$diff_range" ]; then
+    timed diff_coverage
+fi
+if [ $dead_code_report == 1 ]; then
+    timed dead_code
+fi
+if [ $profiling == 1 ]; then
+    timed profile
+fi
+timed gen_report
+if [ $record_history == 1 ]; then
+    history_record
+fi
 print_color "Finished running all reports 🚀" cyan 
 exit
\ No newline at end of file
@@ -0,0 +1,200 @@
+/*
+ astroguard function profiling runtime
+ Linked into the -finstrument-functions build of the input file when astroguard runs with -p.
+
+ The enter/exit hooks only append a (function, timestamp) event to a fixed-size ring buffer.
+ When the ring fills up, and once more at exit, the events are replayed against a shadow call stack
+ to accumulate per-function call counts and inclusive/exclusive time in a small open-addressed table.
+ The table is written to $AG_PROF_OUT as "address calls inclusive_ns exclusive_ns" lines.
+
+ The recorder keeps no locks and assumes a single thread of execution.
+*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define AG_PROF_NO_INSTRUMENT __attribute__((no_instrument_function))
+
+#define AG_RING_SIZE 4096
+#define AG_TABLE_SIZE 1024
+#define AG_STACK_DEPTH 256
+
+struct ag_event {
+    uintptr_t fn;
+    uint64_t ns;
+};
+
+struct ag_frame {
+    uintptr_t fn;
+    uint64_t start;
+    uint64_t children;
+};
+
+struct ag_func {
+    uintptr_t fn;
+    unsigned long calls;
+    unsigned long active;
+    uint64_t inclusive;
+    uint64_t exclusive;
+};
+
+// Exit events are tagged in the top bit of the timestamp, function addresses are not always aligned
+#define AG_EXIT_BIT ((uint64_t) 1 << 63)
+
+static struct ag_event ag_ring[AG_RING_SIZE];
+static unsigned int ag_ring_head;
+
+static struct ag_frame ag_stack[AG_STACK_DEPTH];
+static unsigned int ag_stack_top;
+
+static struct ag_func ag_table[AG_TABLE_SIZE];
+
+void __cyg_profile_func_enter(void *fn, void *call_site) AG_PROF_NO_INSTRUMENT;
+void __cyg_profile_func_exit(void *fn, void *call_site) AG_PROF_NO_INSTRUMENT;
+
+static AG_PROF_NO_INSTRUMENT uint64_t ag_now(void) {
+    struct timespec ts;
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static AG_PROF_NO_INSTRUMENT struct ag_func *ag_lookup(uintptr_t fn) {
+    unsigned int slot = (unsigned int) (fn >> 4) & (AG_TABLE_SIZE - 1);
+
+    for (unsigned int probe = 0; probe < AG_TABLE_SIZE; ++probe) {
+        struct ag_func *entry = &ag_table[(slot + probe) & (AG_TABLE_SIZE - 1)];
+        if (entry->fn == fn || entry->fn == 0) {
+            entry->fn = fn;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+// Closes the top frame of the shadow stack at ns
+static AG_PROF_NO_INSTRUMENT void ag_pop(uint64_t ns) {
+    ag_stack_top--;
+    if (ag_stack_top >= AG_STACK_DEPTH) {
+        return;
+    }
+
+    const struct ag_frame *frame = &ag_stack[ag_stack_top];
+    uint64_t elapsed = ns - frame->start;
+    struct ag_func *entry = ag_lookup(frame->fn);
+
+    if (entry != NULL) {
+        entry->active--;
+        entry->exclusive += elapsed - frame->children;
+        // Recursive calls are only counted once towards inclusive time
+        if (entry->active == 0) {
+            entry->inclusive += elapsed;
+        }
+    }
+    if (ag_stack_top > 0) {
+        ag_stack[ag_stack_top - 1].children += elapsed;
+    }
+}
+
+// Replays the buffered events against the shadow stack and empties the ring
+static AG_PROF_NO_INSTRUMENT void ag_drain(void) {
+    for (unsigned int i = 0; i < ag_ring_head; ++i) {
+        const struct ag_event *event = &ag_ring[i];
+
+        uint64_t ns = event->ns & ~AG_EXIT_BIT;
+
+        if ((event->ns & AG_EXIT_BIT) == 0) {
+            struct ag_func *entry = ag_lookup(event->fn);
+            if (entry != NULL) {
+                entry->calls++;
+                entry->active++;
+            }
+            if (ag_stack_top < AG_STACK_DEPTH) {
+                ag_stack[ag_stack_top].fn = event->fn;
+                ag_stack[ag_stack_top].start = ns;
+                ag_stack[ag_stack_top].children = 0;
+            }
+            ag_stack_top++;
+            continue;
+        }
+
+        if (ag_stack_top == 0) {
+            continue;
+        }
+        // Frames past the recorded depth are unknown and taken to match
+        if (ag_stack_top > AG_STACK_DEPTH) {
+            ag_pop(ns);
+            continue;
+        }
+
+        // A longjmp skips the exits of the frames it unwinds, they are closed when a frame below them exits
+        unsigned int match = ag_stack_top;
+        while (match > 0 && ag_stack[match - 1].fn != event->fn) {
+            match--;
+        }
+        if (match == 0) {
+            continue;
+        }
+        while (ag_stack_top >= match) {
+            ag_pop(ns);
+        }
+    }
+
+    ag_ring_head = 0;
+}
+
+static AG_PROF_NO_INSTRUMENT void ag_record(uintptr_t fn, uint64_t exit_bit) {
+    ag_ring[ag_ring_head].fn = fn;
+    ag_ring[ag_ring_head].ns = ag_now() | exit_bit;
+    if (++ag_ring_head == AG_RING_SIZE) {
+        ag_drain();
+    }
+}
+
+void __cyg_profile_func_enter(void *fn, void *call_site) {
+    (void) call_site;
+    ag_record((uintptr_t) fn, 0);
+}
+
+void __cyg_profile_func_exit(void *fn, void *call_site) {
+    (void) call_site;
+    ag_record((uintptr_t) fn, AG_EXIT_BIT);
+}
+
+static AG_PROF_NO_INSTRUMENT void ag_prof_dump(void) {
+    const char *path = getenv("AG_PROF_OUT");
+    FILE *out;
+
+    ag_drain();
+
+    // Close the frames still open when exit() is called from inside the program
+    while (ag_stack_top > 0) {
+        unsigned int top = ag_stack_top - 1;
+        ag_ring[0].fn = top < AG_STACK_DEPTH ? ag_stack[top].fn : 0;
+        ag_ring[0].ns = ag_now() | AG_EXIT_BIT;
+        ag_ring_head = 1;
+        ag_drain();
+    }
+
+    out = fopen(path != NULL ? path : "profile.out", "w");
+    if (out == NULL) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < AG_TABLE_SIZE; ++i) {
+        if (ag_table[i].fn != 0) {
+            (void) fprintf(out, "%lx %lu %llu %llu\n", (unsigned long) ag_table[i].fn, ag_table[i].calls,
+                           (unsigned long long) ag_table[i].inclusive, (unsigned long long) ag_table[i].exclusive);
+        }
+    }
+
+    (void) fclose(out);
+}
+
+__attribute__((constructor)) static AG_PROF_NO_INSTRUMENT void ag_prof_register(void) {
+    (void) atexit(ag_prof_dump);
+}
@@ -0,0 +1,104 @@
+/*
+ astroguard live coverage runtime
+ Linked (without --coverage) into the coverage build of the input file when astroguard runs with -s.
+
+ A helper thread waits for SIGUSR1. On every signal it dumps the gcov counters into a new
+ timestamped directory below $AG_SNAPSHOT_DIR and resets them, so each snapshot only holds
+ the counts gathered since the previous one. The directory is then appended to
+ $AG_SNAPSHOT_DIR/index, which astroguard polls to ingest the deltas while the process keeps running.
+ $AG_SNAPSHOT_STRIP is passed on as GCOV_PREFIX_STRIP for the snapshot dumps only.
+ A last snapshot is taken at exit, so the regular exit dump of the program is left empty.
+
+ SIGUSR1 is blocked in every other thread of the program, so it is reserved for astroguard.
+ Counts recorded by other threads between the dump and the reset are lost.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+extern void __gcov_dump(void);
+extern void __gcov_reset(void);
+
+static sigset_t ag_snapshot_signals;
+static pthread_mutex_t ag_snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *ag_snapshot_root;
+static const char *ag_snapshot_strip;
+static unsigned int ag_snapshot_seq;
+
+// Must be called with ag_snapshot_lock held
+static void ag_snapshot(void) {
+    const char *root = ag_snapshot_root;
+    unsigned int seq = ag_snapshot_seq++;
+    char dir[4096];
+    char index[4096];
+    FILE *out;
+
+    (void) snprintf(dir, sizeof(dir), "%s/%06u-%ld", root, seq, (long) time(NULL));
+    (void) snprintf(index, sizeof(index), "%s/index", root);
+    if (mkdir(dir, 0755) != 0) {
+        return;
+    }
+
+    // GCOV_PREFIX and GCOV_PREFIX_STRIP are read on every dump, unsetting them sends the exit dump to the usual place
+    (void) setenv("GCOV_PREFIX", dir, 1);
+    if (ag_snapshot_strip != NULL) {
+        (void) setenv("GCOV_PREFIX_STRIP", ag_snapshot_strip, 1);
+    }
+    __gcov_dump();
+    __gcov_reset();
+    (void) unsetenv("GCOV_PREFIX");
+    (void) unsetenv("GCOV_PREFIX_STRIP");
+
+    out = fopen(index, "a");
+    if (out != NULL) {
+        (void) fprintf(out, "%s\n", dir);
+        (void) fclose(out);
+    }
+}
+
+static void *ag_snapshot_loop(void *arg) {
+    int sig;
+
+    (void) arg;
+    for (;;) {
+        if (sigwait(&ag_snapshot_signals, &sig) == 0) {
+            (void) pthread_mutex_lock(&ag_snapshot_lock);
+            ag_snapshot();
+            (void) pthread_mutex_unlock(&ag_snapshot_lock);
+        }
+    }
+
+    return NULL;
+}
+
+// Runs before the libgcov destructor; the lock is kept so no snapshot can start after this one
+static void ag_snapshot_final(void) {
+    (void) pthread_mutex_lock(&ag_snapshot_lock);
+    ag_snapshot();
+}
+
+__attribute__((constructor)) static void ag_snapshot_start(void) {
+    pthread_t thread;
+
+    ag_snapshot_root = getenv("AG_SNAPSHOT_DIR");
+    ag_snapshot_strip = getenv("AG_SNAPSHOT_STRIP");
+    if (ag_snapshot_root == NULL) {
+        return;
+    }
+
+    // Threads created later by the program inherit the blocked mask
+    (void) sigemptyset(&ag_snapshot_signals);
+    (void) sigaddset(&ag_snapshot_signals, SIGUSR1);
+    (void) pthread_sigmask(SIG_BLOCK, &ag_snapshot_signals, NULL);
+
+    if (pthread_create(&thread, NULL, ag_snapshot_loop, NULL) == 0) {
+        (void) pthread_detach(thread);
+    }
+    (void) atexit(ag_snapshot_final);
+}
@@ -0,0 +1,61 @@
+/*
+ astroguard loop profiling runtime
+ Force-included (gcc -include) into the instrumented copy of the input file when astroguard runs with -l.
+
+ Every instrumented loop owns one slot in a flat, statically allocated counter table.
+ AG_LOOP_ENTER(k) is placed in front of loop k and AG_LOOP_TICK(k) at the top of its body.
+ Counters are plain (non-atomic) increments so instrumented runs stay close to native speed.
+ The table is written to $AG_LOOP_OUT at exit as "slot entries total max" lines.
+*/
+
+#ifndef ASTROGUARD_LOOP_PROFILE_H
+#define ASTROGUARD_LOOP_PROFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef AG_LOOP_SLOTS
+#define AG_LOOP_SLOTS 1
+#endif
+
+struct ag_loop_slot {
+    unsigned long current;
+    unsigned long max;
+    unsigned long total;
+    unsigned long entries;
+};
+
+static struct ag_loop_slot ag_loop_table[AG_LOOP_SLOTS];
+
+// Folds the iterations of the invocation that just finished into the slot maximum
+static inline void ag_loop_fold(struct ag_loop_slot *slot) {
+    if (slot->current > slot->max) {
+        slot->max = slot->current;
+    }
+    slot->current = 0;
+}
+
+#define AG_LOOP_ENTER(k) (ag_loop_fold(&ag_loop_table[k]), ag_loop_table[k].entries++)
+#define AG_LOOP_TICK(k) (ag_loop_table[k].current++, ag_loop_table[k].total++)
+
+static void ag_loop_dump(void) {
+    const char *path = getenv("AG_LOOP_OUT");
+    FILE *out = fopen(path != NULL ? path : "loops.out", "w");
+
+    if (out == NULL) {
+        return;
+    }
+
+    for (int k = 0; k < AG_LOOP_SLOTS; ++k) {
+        ag_loop_fold(&ag_loop_table[k]);
+        (void) fprintf(out, "%d %lu %lu %lu\n", k, ag_loop_table[k].entries, ag_loop_table[k].total, ag_loop_table[k].max);
+    }
+
+    (void) fclose(out);
+}
+
+__attribute__((constructor)) static void ag_loop_register(void) {
+    (void) atexit(ag_loop_dump);
+}
+
+#endif